@@ -0,0 +1,173 @@
+#pragma once
+
+#include <math.h>
+#include <stdlib.h>
+
+
+/***************************************************************************************/
+namespace Metric {
+    enum class Type { Euclidean, Manhattan, Chebyshev, Cosine, InnerProduct };
+
+    /*
+     * Each metric is a policy used as template argument of the search,
+     * so every metric gets its own inlined distance loop.
+     * A policy supplies:
+     *  distance(a, b, dim): reduced distance, monotone in the true distance
+     *  axis_bound(d_axis):  lower bound of the reduced distance to any point
+     *                       behind a splitting plane at signed offset d_axis
+     *  finalize(dist):      converts the reduced distance to the true distance
+     *  normalize:           whether points have to be scaled to unit length
+     *  augment:             whether points get the extra inner product coordinate
+    */
+
+    // squared distance is used during the search, the sqrt is taken once at the end
+    struct Euclidean {
+        static constexpr bool normalize = false;
+        static constexpr bool augment = false;
+
+        static inline float distance(const float* a, const float* b, int dim){
+            float dist = 0;
+            #pragma omp simd reduction(+:dist)
+            for(int i = 0; i < dim; ++i){
+                float tmp = a[i] - b[i];
+                dist += tmp * tmp;
+            }
+            return dist;
+        }
+        static inline float axis_bound(float d_axis){ return d_axis * d_axis; }
+        static inline float finalize(float dist){ return sqrt(dist); }
+    };
+
+    // L1 norm
+    struct Manhattan {
+        static constexpr bool normalize = false;
+        static constexpr bool augment = false;
+
+        static inline float distance(const float* a, const float* b, int dim){
+            float dist = 0;
+            #pragma omp simd reduction(+:dist)
+            for(int i = 0; i < dim; ++i){
+                dist += fabsf(a[i] - b[i]);
+            }
+            return dist;
+        }
+        static inline float axis_bound(float d_axis){ return fabsf(d_axis); }
+        static inline float finalize(float dist){ return dist; }
+    };
+
+    // L-infinity norm
+    struct Chebyshev {
+        static constexpr bool normalize = false;
+        static constexpr bool augment = false;
+
+        static inline float distance(const float* a, const float* b, int dim){
+            float dist = 0;
+            #pragma omp simd reduction(max:dist)
+            for(int i = 0; i < dim; ++i){
+                dist = fmaxf(dist, fabsf(a[i] - b[i]));
+            }
+            return dist;
+        }
+        static inline float axis_bound(float d_axis){ return fabsf(d_axis); }
+        static inline float finalize(float dist){ return dist; }
+    };
+
+    /*
+     * Cosine distance (1 - cos) on unit vectors equals half the squared
+     * euclidian distance, so the euclidian search and pruning can be reused.
+    */
+    struct Cosine {
+        static constexpr bool normalize = true;
+        static constexpr bool augment = false;
+
+        static inline float distance(const float* a, const float* b, int dim){
+            return Euclidean::distance(a, b, dim);
+        }
+        static inline float axis_bound(float d_axis){ return d_axis * d_axis; }
+        static inline float finalize(float dist){ return dist / 2; }
+    };
+
+    /*
+     * Maximum inner product search, reduced to euclidian nearest neighbor:
+     * with M the largest point norm, every point p gets the extra coordinate
+     * sqrt(M^2 - |p|^2) and every query q the extra coordinate 0 (see augment).
+     * Then |p' - q'|^2 = M^2 + |q|^2 - 2 p.q, so the nearest augmented point
+     * has the largest inner product with the query.
+    */
+    struct InnerProduct {
+        static constexpr bool normalize = false;
+        static constexpr bool augment = true;
+
+        static inline float distance(const float* a, const float* b, int dim){
+            return Euclidean::distance(a, b, dim);
+        }
+        static inline float axis_bound(float d_axis){ return d_axis * d_axis; }
+        static inline float finalize(float dist){ return dist; }
+
+        // the extra coordinate of a query is 0, so this is the plain inner product
+        static inline float inner_product(const float* a, const float* b, int dim){
+            float dot = 0;
+            #pragma omp simd reduction(+:dot)
+            for(int i = 0; i < dim; ++i){
+                dot += a[i] * b[i];
+            }
+            return dot;
+        }
+    };
+
+    // value reported for a query and its nearest neighbor
+    template<typename M>
+    inline float result(const float* query, const float* neighbor, int dim){
+        return M::finalize(M::distance(query, neighbor, dim));
+    }
+
+    template<>
+    inline float result<InnerProduct>(const float* query, const float* neighbor, int dim){
+        return InnerProduct::inner_product(query, neighbor, dim);
+    }
+
+    /*
+     * Copy points and queries to a new array with dim + 1 coordinates
+     * per vector, filled with the extra coordinate of InnerProduct.
+     * The caller frees the returned array
+    */
+    inline float* augment(const float* x, int dim, int num_points, int num_queries){
+        float* augmented = (float*)calloc((dim + 1) * (num_points + num_queries), sizeof(float));
+
+        float max_norm_squared = 0;
+        for(int n = 0; n < num_points; ++n){
+            float norm_squared = InnerProduct::inner_product(x + n * dim, x + n * dim, dim);
+            max_norm_squared = fmaxf(max_norm_squared, norm_squared);
+        }
+
+        for(int n = 0; n < num_points + num_queries; ++n){
+            const float* from = x + n * dim;
+            float* to = augmented + n * (dim + 1);
+            for(int d = 0; d < dim; ++d){
+                to[d] = from[d];
+            }
+            if (n < num_points){
+                float norm_squared = InnerProduct::inner_product(from, from, dim);
+                to[dim] = sqrt(fmaxf(max_norm_squared - norm_squared, 0));
+            }
+        }
+        return augmented;
+    }
+
+    // scale vector to unit length, zero vectors are left unchanged
+    inline void normalize(float* x, int dim){
+        float norm = 0;
+        #pragma omp simd reduction(+:norm)
+        for(int i = 0; i < dim; ++i){
+            norm += x[i] * x[i];
+        }
+        if (norm == 0){return;}
+
+        float scale = 1 / sqrt(norm);
+        #pragma omp simd
+        for(int i = 0; i < dim; ++i){
+            x[i] *= scale;
+        }
+    }
+}
+/***************************************************************************************/
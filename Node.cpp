@@ -1,4 +1,5 @@
 #include "Node.hpp"
+#include "Metric.hpp"
 
 
 Point::Point() = default;
@@ -28,6 +29,15 @@ std::ostream& operator<<(std::ostream &strm, const Point &point) {
 }
 
 
+float Point::distance_squared(Point &a, Point &b){
+    if(a.dimension != b.dimension){
+        std::cout << "Dimensions do not match!" << std::endl;
+        exit(1);
+    }
+    return Metric::Euclidean::distance(a.coordinates, b.coordinates, a.dimension);
+}
+
+
 float Point::distance_squared(Point &b){
     return Point::distance_squared(*this, b);
 }
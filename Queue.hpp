@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+/***************************************************************************************/
+/*
+ * Blocking queue with a fixed capacity, used to connect the stages
+ * of the query server. A full queue stalls the producer instead of
+ * buffering without limit.
+*/
+template<typename T>
+class BoundedQueue {
+    public:
+        BoundedQueue(size_t capacity) : capacity{capacity} {};
+        ~BoundedQueue() = default;
+
+        // blocks while the queue is full
+        void push(T item){
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [this]{ return items.size() < capacity; });
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+        }
+
+        // blocks while the queue is empty, false once closed and drained
+        bool pop(T &item){
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this]{ return !items.empty() || closed; });
+            if (items.empty()){
+                return false;
+            }
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+
+        // no more items will be pushed
+        void close(){
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            not_empty.notify_all();
+        }
+
+    private:
+        size_t capacity;
+        bool closed = false;
+        std::deque<T> items;
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::condition_variable not_empty;
+};
+/***************************************************************************************/
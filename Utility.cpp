@@ -1,3 +1,12 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include "Utility.hpp"
 
 
@@ -101,7 +110,7 @@ namespace Utility {
         validate_input(*seed, *dim, *num_points);
     }
         
-    void specify_problem(int argc, char** argv, int* seed, int* dim, int* num_points){
+    void specify_problem(int argc, char** argv, int* seed, int* dim, int* num_points, std::ostream &status){
         // validate arguments
         // you will receive a string specifying the dataset you work on and
         // a initialization number determining the initialization used in
@@ -111,7 +120,7 @@ namespace Utility {
             exit(1);
         }
         
-        std::cout << "READY" << std::endl;
+        status << "READY" << std::endl;
         *seed = std::stoi(argv[1]);
         *dim = std::stoi(argv[2]);
         *num_points = std::stoi(argv[3]);
@@ -119,6 +128,122 @@ namespace Utility {
         validate_input(*seed, *dim, *num_points);
     }
 
+    // parse a whole string as integer, false if it is empty, malformed or out of range
+    static bool parse_long(const std::string &text, long* value){
+        char* end;
+        errno = 0;
+        *value = strtol(text.c_str(), &end, 10);
+        return !text.empty() && *end == '\0' && errno == 0;
+    }
+
+    int parse_options(int argc, char** argv, Options* options, bool parallel){
+        int remaining = 1;
+        for(int i = 1; i < argc; ++i){
+            std::string arg = argv[i];
+
+            bool parallel_only = arg.rfind("--threads=", 0) == 0 || arg.rfind("--cutoff=", 0) == 0
+                || arg == "--serve" || arg.rfind("--socket=", 0) == 0;
+            if (parallel_only && !parallel){
+                std::cerr << "Option " << arg << " is only supported by the parallel version!" << std::endl;
+                exit(1);
+            }
+
+            if (arg.rfind("--threads=", 0) == 0){
+                long num_threads;
+                if (!parse_long(arg.substr(10), &num_threads) || num_threads <= 0 || num_threads > INT_MAX){
+                    std::cerr << "Number of threads has to be an integer larger than 0!" << std::endl;
+                    exit(1);
+                }
+                options->num_threads = (int)num_threads;
+            } else if (arg.rfind("--cutoff=", 0) == 0){
+                if (!parse_long(arg.substr(9), &options->serial_cutoff) || options->serial_cutoff < 0){
+                    std::cerr << "Serial cutoff has to be a non-negative integer!" << std::endl;
+                    exit(1);
+                }
+            } else if (arg.rfind("--metric=", 0) == 0){
+                std::string metric = arg.substr(9);
+                if (metric == "l2"){
+                    options->metric = Metric::Type::Euclidean;
+                } else if (metric == "l1"){
+                    options->metric = Metric::Type::Manhattan;
+                } else if (metric == "linf"){
+                    options->metric = Metric::Type::Chebyshev;
+                } else if (metric == "cosine"){
+                    options->metric = Metric::Type::Cosine;
+                } else if (metric == "ip"){
+                    options->metric = Metric::Type::InnerProduct;
+                } else {
+                    std::cerr << "Metric has to be one of l2, l1, linf, cosine, ip!" << std::endl;
+                    exit(1);
+                }
+            } else if (arg == "--serve"){
+                options->serve = true;
+            } else if (arg.rfind("--socket=", 0) == 0){
+                options->serve = true;
+                options->socket_path = arg.substr(9);
+            } else {
+                // keep positional arguments for specify_problem
+                argv[remaining++] = argv[i];
+            }
+        }
+        return remaining;
+    }
+
+    bool read_full(int fd, void* buffer, size_t size){
+        char* bytes = (char*)buffer;
+        while(size > 0){
+            ssize_t n = read(fd, bytes, size);
+            if (n < 0 && errno == EINTR){continue;}
+            if (n <= 0){return false;}
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+
+    bool write_full(int fd, const void* buffer, size_t size){
+        const char* bytes = (const char*)buffer;
+        while(size > 0){
+            ssize_t n = write(fd, bytes, size);
+            if (n < 0 && errno == EINTR){continue;}
+            if (n <= 0){return false;}
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+
+    int listen_unix_socket(const std::string &path){
+        struct sockaddr_un address;
+        if (path.size() >= sizeof(address.sun_path)){
+            std::cerr << "Socket path is too long!" << std::endl;
+            exit(1);
+        }
+
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path.c_str());
+
+        // only a leftover socket is replaced, any other file is kept
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0){
+            if (!S_ISSOCK(st.st_mode)){
+                std::cerr << "Could not listen on " << path << ": " << strerror(EEXIST) << std::endl;
+                exit(1);
+            }
+            unlink(path.c_str());
+        }
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 1) < 0){
+            std::cerr << "Could not listen on " << path << ": " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        return fd;
+    }
+
     void print_result_line(int ID, float distance){
         std::cout << "ID: " << ID << " \t DISTANCE: " << distance << std::endl;
     }
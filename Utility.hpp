@@ -1,10 +1,25 @@
 #include <iostream>
 #include <random>
+#include <string>
 #include <math.h>
 
 #include "Node.hpp"
+#include "Metric.hpp"
 
 namespace Utility {
+    // command line options of the tree build and the search
+    struct Options {
+        // 0 keeps the OpenMP default, i.e. respects OMP_NUM_THREADS
+        int num_threads = 0;
+        // subtrees with num_points * dim below this are built serially
+        long serial_cutoff = 1 << 16;
+        // distance used by the nearest neighbor search
+        Metric::Type metric = Metric::Type::Euclidean;
+        // keep answering query frames (from stdin or socket_path) instead of exiting
+        bool serve = false;
+        std::string socket_path;
+    };
+
     // generate random vector based on seed
     float* generate_problem(int seed, int dim, int num_points);
 
@@ -21,7 +36,21 @@ namespace Utility {
     // prompt to specify problem details and validate them
     void validate_input(int seed, int dim, int num_points);
     void specify_problem(int* seed, int* dim, int* num_points);
-    void specify_problem(int argc, char**argv, int* seed, int* dim, int* num_points);
+    // READY is written to status, so the server can keep stdout free for results
+    void specify_problem(int argc, char**argv, int* seed, int* dim, int* num_points, std::ostream &status = std::cout);
+
+    // parse --threads=N, --cutoff=N, --metric=l2|l1|linf|cosine|ip,
+    // --serve and --socket=PATH, removing them from argv
+    // all but --metric are rejected unless parallel is set
+    // returns the number of remaining arguments
+    int parse_options(int argc, char** argv, Options* options, bool parallel);
+
+    // read / write exactly size bytes, false on end of stream or error
+    bool read_full(int fd, void* buffer, size_t size);
+    bool write_full(int fd, const void* buffer, size_t size);
+
+    // create a unix socket listening on path, replacing a stale socket but no other file
+    int listen_unix_socket(const std::string &path);
 
     // print results
     void print_result_line(int ID, float distance);
@@ -2,39 +2,35 @@
 #include <iostream>
 #include <functional>
 #include <chrono>
+#include <errno.h>
 #include <random>
 #include <math.h>
 #include <omp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "Utility.hpp"
+#include "Queue.hpp"
 
 #define DEBUG 0
 
-/***************************************************************************************/
-float Point::distance_squared(Point &a, Point &b){
-    if(a.dimension != b.dimension){
-        std::cout << "Dimensions do not match!" << std::endl;
-        exit(1);
-    }
-    float dist = 0;
-
-    /*
-     * Vectorizing loop computing squared distance
-     * and collecting the sum of all dist to one
-     * using reduction directive
-    */
-    #pragma omp simd reduction(+:dist)
-    for(int i = 0; i < a.dimension; ++i){
-        float tmp = a.coordinates[i] - b.coordinates[i];
-        dist += tmp * tmp;
-    }
-    return dist;
-}
-/***************************************************************************************/
+// number of frames buffered between the stages of the query server
+#define SERVE_QUEUE_CAPACITY 16
+// larger frames are rejected, which also bounds the memory held by the queues
+#define SERVE_MAX_FRAME_QUERIES 4096
+// latency is reported every SERVE_LATENCY_WINDOW frames or SERVE_REPORT_SECONDS,
+// whichever comes first
+#define SERVE_LATENCY_WINDOW 1024
+#define SERVE_REPORT_SECONDS 10
 
 
 /***************************************************************************************/
-Node* build_tree_rec(Point** point_list, int num_points, int depth){
+Node* build_tree_rec(Point** point_list, int num_points, int depth, const Utility::Options &options){
     if (num_points <= 0){
         return nullptr;
     }
@@ -69,18 +65,31 @@ Node* build_tree_rec(Point** point_list, int num_points, int depth){
     Node* left_node;
     Node * right_node;
 
+    /*
+     * The work of a subtree is proportional to num_points * dim,
+     * so small subtrees are built serially without any task overhead
+     * (all of their descendants are even smaller)
+    */
+    long work = (long)num_points * dim;
+    if (work < options.serial_cutoff){
+        left_node = build_tree_rec(left_points, num_points_left, depth + 1, options);
+        right_node = build_tree_rec(right_points, num_points_right, depth + 1, options);
+        return new Node(*median, left_node, right_node);
+    }
+
     /*
      * Defining left_node & right node as shared variables
      * because otherwise they would be firstprivate
-     * Maximum depth is set to 8 after trial and error
+     * Idle threads of the team pick up pending tasks,
+     * which balances the unequal subtrees
     */
     // left subtree
-    #pragma omp task shared(left_node) if(depth < 8)
-    left_node = build_tree_rec(left_points, num_points_left, depth + 1);
-    
+    #pragma omp task shared(left_node)
+    left_node = build_tree_rec(left_points, num_points_left, depth + 1, options);
+
     // right subtree
-    #pragma omp task shared(right_node) if(depth < 8)
-    right_node = build_tree_rec(right_points, num_points_right, depth + 1);
+    #pragma omp task shared(right_node)
+    right_node = build_tree_rec(right_points, num_points_right, depth + 1, options);
 
     /*
      * Before returning the subtree both the left and
@@ -92,13 +101,14 @@ Node* build_tree_rec(Point** point_list, int num_points, int depth){
     return new Node(*median, left_node, right_node); 
 }
 
-Node* build_tree(Point** point_list, int num_nodes){
-    return build_tree_rec(point_list, num_nodes, 0);
+Node* build_tree(Point** point_list, int num_nodes, const Utility::Options &options){
+    return build_tree_rec(point_list, num_nodes, 0, options);
 }
 /***************************************************************************************/
 
 
 /***************************************************************************************/
+template<typename M>
 Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist) {
     // leaf node
     if (root == nullptr){
@@ -111,13 +121,13 @@ Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist)
     Node* best_local = best;
     float best_dist_local = best_dist;
 
-    float d_euclidian = root->point->distance_squared(*query);
+    float d_metric = M::distance(root->point->coordinates, query->coordinates, dim);
     float d_axis = query->coordinates[axis] - root->point->coordinates[axis];
-    float d_axis_squared = d_axis * d_axis;
+    float d_axis_bound = M::axis_bound(d_axis);
 
-    if (d_euclidian < best_dist_local){
+    if (d_metric < best_dist_local){
         best_local = root;
-        best_dist_local = d_euclidian;
+        best_dist_local = d_metric;
     }
 
     Node* visit_branch;
@@ -133,19 +143,19 @@ Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist)
         other_branch = root->left;
     }
 
-    Node* further = nearest(visit_branch, query, depth + 1, best_local, best_dist_local);
+    Node* further = nearest<M>(visit_branch, query, depth + 1, best_local, best_dist_local);
     if (further != nullptr){
-        float dist_further = further->point->distance_squared(*query);
+        float dist_further = M::distance(further->point->coordinates, query->coordinates, dim);
         if (dist_further < best_dist_local){
             best_dist_local = dist_further;
             best_local = further;
         }
     }
 
-    if (d_axis_squared < best_dist_local) {
-        further = nearest(other_branch, query, depth + 1, best_local, best_dist_local);
+    if (d_axis_bound < best_dist_local) {
+        further = nearest<M>(other_branch, query, depth + 1, best_local, best_dist_local);
         if (further != nullptr){
-            float dist_further = further->point->distance_squared(*query);
+            float dist_further = M::distance(further->point->coordinates, query->coordinates, dim);
             if (dist_further < best_dist_local){
                 // best_dist_local = dist_further;
                 best_local = further;
@@ -157,26 +167,257 @@ Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist)
 }
 
 
+template<typename M>
 Node* nearest_neighbor(Node* root, Point* query){
-    float best_dist = root->point->distance_squared(*query);
-    return nearest(root, query, 0, root, best_dist);
+    float best_dist = M::distance(root->point->coordinates, query->coordinates, query->dimension);
+    return nearest<M>(root, query, 0, root, best_dist);
+}
+
+
+/***************************************************************************************/
+template<typename M>
+void solve_queries(Node* tree, float* x, int dim, int num_points, int num_queries){
+    /*
+     * Parallelizing for loop in order to solve the queries
+     * "concurrently", while making sure the results are printed
+     * in the requested order (ordered parameter)
+     * By default its thread will get num_queries/threads iterations
+     * and the scheduling will be static
+    */
+    #pragma omp parallel for ordered
+    for(int q = 0; q < num_queries; ++q){
+        float* x_query = x + (num_points + q) * dim;
+        Point query(dim, num_points + q, x_query);
+
+        Node* res = nearest_neighbor<M>(tree, &query);
+
+        // output min-distance (i.e. to query point)
+        float min_distance = Metric::result<M>(
+            query.coordinates, res->point->coordinates, dim);
+
+        /*
+         * Sets a "barrier" making sure the loop iterations are
+         * executed the way the loop executes in a sequential way
+        */
+        #pragma omp ordered
+        {
+            Utility::print_result_line(query.ID, min_distance);
+        }
+
+        #if DEBUG
+            // in case you want to have further debug information about
+            // the query point and the nearest neighbor
+            // std::cout << "Query: " << query << std::endl;
+            // std::cout << "NN: " << *res->point << std::endl << std::endl;
+        #endif
+    }
+}
+
+
+/***************************************************************************************/
+/*
+ * Query server
+ * A request frame is a uint32 count followed by count * dim floats,
+ * with count at most SERVE_MAX_FRAME_QUERIES,
+ * the response frame holds count pairs of (int32 ID, float distance)
+ * of the nearest neighbors. Reading, searching and writing run
+ * concurrently, connected by bounded queues.
+*/
+struct Frame {
+    uint32_t count;
+    std::vector<float> queries;
+    std::vector<int32_t> ids;
+    std::vector<float> distances;
+    std::chrono::steady_clock::time_point received;
+};
+
+
+// print p50 / p99 of the latencies (in microseconds) and start a new window
+void report_latency(std::vector<double> &latencies){
+    if (latencies.empty()){return;}
+
+    std::sort(latencies.begin(), latencies.end());
+    double p50 = latencies[(latencies.size() - 1) * 50 / 100];
+    double p99 = latencies[(latencies.size() - 1) * 99 / 100];
+    std::cerr << "Latency of last " << latencies.size() << " frames: p50 " << p50
+              << " us, p99 " << p99 << " us" << std::endl;
+    latencies.clear();
+}
+
+
+template<typename M>
+void serve_connection(Node* tree, int dim, int fd_in, int fd_out){
+    BoundedQueue<Frame> parsed(SERVE_QUEUE_CAPACITY);
+    BoundedQueue<Frame> answered(SERVE_QUEUE_CAPACITY);
+    size_t served = 0;
+
+    // queries are sent without the extra inner product coordinate
+    int frame_dim = M::augment ? dim - 1 : dim;
+
+    // reader: parse frames until end of stream or an empty frame
+    std::thread reader([&]{
+        Frame frame;
+        while(Utility::read_full(fd_in, &frame.count, sizeof(frame.count)) && frame.count > 0){
+            if (frame.count > SERVE_MAX_FRAME_QUERIES){
+                std::cerr << "Frame of " << frame.count << " queries exceeds the maximum of "
+                          << SERVE_MAX_FRAME_QUERIES << ", closing connection!" << std::endl;
+                break;
+            }
+            frame.queries.resize((size_t)frame.count * dim);
+            if (!Utility::read_full(fd_in, frame.queries.data(), (size_t)frame.count * frame_dim * sizeof(float))){
+                std::cerr << "Truncated query frame!" << std::endl;
+                break;
+            }
+
+            // spread the queries to dim coordinates, back to front so nothing is overwritten
+            if constexpr (M::augment){
+                for(size_t q = frame.count; q-- > 0;){
+                    memmove(frame.queries.data() + q * dim, frame.queries.data() + q * frame_dim, frame_dim * sizeof(float));
+                    frame.queries[q * dim + frame_dim] = 0;
+                }
+            }
+            frame.received = std::chrono::steady_clock::now();
+            parsed.push(std::move(frame));
+        }
+        parsed.close();
+    });
+
+    // writer: send results in the order the frames arrived
+    // and report the latency from receiving a frame until its results were written
+    std::thread writer([&]{
+        Frame frame;
+        bool connected = true;
+        std::vector<char> buffer;
+        std::vector<double> latencies;
+        latencies.reserve(SERVE_LATENCY_WINDOW);
+        auto last_report = std::chrono::steady_clock::now();
+        while(answered.pop(frame)){
+            if (!connected){continue;}
+            buffer.resize(frame.count * (sizeof(int32_t) + sizeof(float)));
+            char* out = buffer.data();
+            for(uint32_t q = 0; q < frame.count; ++q){
+                memcpy(out, &frame.ids[q], sizeof(int32_t));
+                memcpy(out + sizeof(int32_t), &frame.distances[q], sizeof(float));
+                out += sizeof(int32_t) + sizeof(float);
+            }
+            connected = Utility::write_full(fd_out, buffer.data(), buffer.size());
+
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::duration<double, std::micro> latency = now - frame.received;
+            latencies.push_back(latency.count());
+            ++served;
+
+            if (latencies.size() >= SERVE_LATENCY_WINDOW || now - last_report >= std::chrono::seconds(SERVE_REPORT_SECONDS)){
+                report_latency(latencies);
+                last_report = now;
+            }
+        }
+        report_latency(latencies);
+    });
+
+    // search the queries of each frame in parallel
+    Frame frame;
+    while(parsed.pop(frame)){
+        frame.ids.resize(frame.count);
+        frame.distances.resize(frame.count);
+
+        #pragma omp parallel for schedule(dynamic)
+        for(uint32_t q = 0; q < frame.count; ++q){
+            float* x_query = frame.queries.data() + (size_t)q * dim;
+            if constexpr (M::normalize){
+                Metric::normalize(x_query, dim);
+            }
+            Point query(dim, q, x_query);
+
+            Node* res = nearest_neighbor<M>(tree, &query);
+            frame.ids[q] = res->point->ID;
+            frame.distances[q] = Metric::result<M>(
+                query.coordinates, res->point->coordinates, dim);
+        }
+        answered.push(std::move(frame));
+    }
+    answered.close();
+
+    reader.join();
+    writer.join();
+
+    std::cerr << "Served " << served << " frames" << std::endl;
 }
 
 
+template<typename M>
+void serve_queries(Node* tree, int dim, const Utility::Options &options){
+    // a client hanging up should end its connection, not the server
+    signal(SIGPIPE, SIG_IGN);
+
+    if (options.socket_path.empty()){
+        serve_connection<M>(tree, dim, STDIN_FILENO, STDOUT_FILENO);
+        return;
+    }
+
+    // serve one client after the other until killed or accept fails
+    int server = Utility::listen_unix_socket(options.socket_path);
+    std::cerr << "Listening on " << options.socket_path << std::endl;
+    while(true){
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0){
+            if (errno == EINTR){continue;}
+            std::cerr << "Could not accept connection: " << strerror(errno) << std::endl;
+            break;
+        }
+        serve_connection<M>(tree, dim, client, client);
+        close(client);
+    }
+
+    close(server);
+    unlink(options.socket_path.c_str());
+}
 /***************************************************************************************/
+
+
+/***************************************************************************************/
+template<typename M>
+void run_queries(Node* tree, float* x, int dim, int num_points, int num_queries, const Utility::Options &options){
+    if (options.serve){
+        serve_queries<M>(tree, dim, options);
+    } else {
+        solve_queries<M>(tree, x, dim, num_points, num_queries);
+    }
+}
+
+
 int main(int argc, char **argv){
     int seed = 0;
     int dim = 0;
     int num_points = 0;
     int num_queries = 10;
 
+    Utility::Options options;
+    argc = Utility::parse_options(argc, argv, &options, true);
+
+    // the server keeps stdout for result frames, so READY / DONE go to stderr
+    std::ostream &status = options.serve ? std::cerr : std::cout;
+
+    /*
+     * Number of threads is only set when given with --threads,
+     * otherwise OMP_NUM_THREADS (or the number of cores) is used
+    */
+    if (options.num_threads > 0){
+        omp_set_num_threads(options.num_threads);
+    }
+
     #if DEBUG
         // for measuring your local runtime
         auto tick = std::chrono::high_resolution_clock::now();
-        Utility::specify_problem(argc, argv, &seed, &dim, &num_points);
+        Utility::specify_problem(argc, argv, &seed, &dim, &num_points, status);
     
     #else
-        Utility::specify_problem(&seed, &dim, &num_points);
+        // the server reads query frames from stdin, so the problem is given as arguments
+        if (options.serve){
+            Utility::specify_problem(argc, argv, &seed, &dim, &num_points, status);
+        } else {
+            Utility::specify_problem(&seed, &dim, &num_points);
+        }
     
     #endif
 
@@ -184,6 +425,22 @@ int main(int argc, char **argv){
     float* x = Utility::generate_problem(seed, dim, num_points + num_queries);
     Point** points = (Point**)calloc(num_points, sizeof(Point*));
 
+    // cosine distance is computed on unit vectors (points and queries)
+    if (options.metric == Metric::Type::Cosine){
+        #pragma omp parallel for
+        for(int n = 0; n < num_points + num_queries; ++n){
+            Metric::normalize(x + n * dim, dim);
+        }
+    }
+
+    // inner product search runs on points and queries with one extra coordinate
+    if (options.metric == Metric::Type::InnerProduct){
+        float* augmented = Metric::augment(x, dim, num_points, num_queries);
+        free(x);
+        x = augmented;
+        dim += 1;
+    }
+
     for(int n = 0; n < num_points; ++n){
         points[n] = new Point(dim, n + 1, x + n * dim);
     }
@@ -194,14 +451,6 @@ int main(int argc, char **argv){
     */
     Node* tree;
 
-    /*
-     * Setting number of threads to 64
-     * Even though the submission server offers 32 CPUs
-     * it seemed that the performance was better with > 32 threads
-     * That may be caused due to the unequal size of problems solved
-     * by each thread when building the tree
-    */
-    omp_set_num_threads(64);
     #pragma omp parallel
     {
         /*
@@ -209,51 +458,40 @@ int main(int argc, char **argv){
          * Starting by initializing the routine using one thread
         */
         #pragma omp single
-        tree = build_tree(points, num_points);
+        tree = build_tree(points, num_points, options);
     }
 
     /*
-     * Parallelizing for loop in order to solve the queries
-     * "concurrently", while making sure the results are printed
-     * in the requested order (ordered parameter)
-     * By default its thread will get num_queries/threads iterations
-     * and the scheduling will be static
+     * Dispatching on the metric once, so that each metric
+     * runs its own specialized search loop
+     * (either the fixed queries or the query server)
     */
-    #pragma omp parallel for ordered
-    for(int q = 0; q < num_queries; ++q){
-        float* x_query = x + (num_points + q) * dim;
-        Point query(dim, num_points + q, x_query);
-
-        Node* res = nearest_neighbor(tree, &query);
-
-        // output min-distance (i.e. to query point)
-        float min_distance = query.distance(*res->point);
-
-        /*
-         * Sets a "barrier" making sure the loop iterations are
-         * executed the way the loop executes in a sequential way
-        */
-        #pragma omp ordered
-        {
-            Utility::print_result_line(query.ID, min_distance);
-        }
-
-        #if DEBUG
-            // in case you want to have further debug information about
-            // the query point and the nearest neighbor
-            // std::cout << "Query: " << query << std::endl;
-            // std::cout << "NN: " << *res->point << std::endl << std::endl;
-        #endif
+    switch(options.metric){
+        case Metric::Type::Euclidean:
+            run_queries<Metric::Euclidean>(tree, x, dim, num_points, num_queries, options);
+            break;
+        case Metric::Type::Manhattan:
+            run_queries<Metric::Manhattan>(tree, x, dim, num_points, num_queries, options);
+            break;
+        case Metric::Type::Chebyshev:
+            run_queries<Metric::Chebyshev>(tree, x, dim, num_points, num_queries, options);
+            break;
+        case Metric::Type::Cosine:
+            run_queries<Metric::Cosine>(tree, x, dim, num_points, num_queries, options);
+            break;
+        case Metric::Type::InnerProduct:
+            run_queries<Metric::InnerProduct>(tree, x, dim, num_points, num_queries, options);
+            break;
     }
 
     #if DEBUG
         // for measuring your local runtime
         auto tock = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed_time = tock - tick;
-        std::cout << "elapsed time " << elapsed_time.count() << " second" << std::endl;
+        status << "elapsed time " << elapsed_time.count() << " second" << std::endl;
     #endif
 
-    std::cout << "DONE" << std::endl;
+    status << "DONE" << std::endl;
 
     // clean-up
     Utility::free_tree(tree);
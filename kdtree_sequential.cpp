@@ -10,22 +10,6 @@
 #define DEBUG 0
 
 
-/***************************************************************************************/
-float Point::distance_squared(Point &a, Point &b){
-    if(a.dimension != b.dimension){
-        std::cout << "Dimensions do not match!" << std::endl;
-        exit(1);
-    }
-    float dist = 0;
-    for(int i = 0; i < a.dimension; ++i){
-        float tmp = a.coordinates[i] - b.coordinates[i];
-        dist += tmp * tmp;
-    }
-    return dist;
-}
-/***************************************************************************************/
-
-
 /***************************************************************************************/
 Node* build_tree_rec(Point** point_list, int num_points, int depth){
     if (num_points <= 0){
@@ -72,6 +56,7 @@ Node* build_tree(Point** point_list, int num_nodes){
 
 
 /***************************************************************************************/
+template<typename M>
 Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist) {
     // leaf node
     if (root == nullptr){
@@ -84,13 +69,13 @@ Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist)
     Node* best_local = best;
     float best_dist_local = best_dist;
     
-    float d_euclidian = root->point->distance_squared(*query);
+    float d_metric = M::distance(root->point->coordinates, query->coordinates, dim);
     float d_axis = query->coordinates[axis] - root->point->coordinates[axis];
-    float d_axis_squared = d_axis * d_axis;
+    float d_axis_bound = M::axis_bound(d_axis);
 
-    if (d_euclidian < best_dist_local){
+    if (d_metric < best_dist_local){
         best_local = root;
-        best_dist_local = d_euclidian;
+        best_dist_local = d_metric;
     }
 
     Node* visit_branch;
@@ -106,19 +91,19 @@ Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist)
         other_branch = root->left;
     }
 
-    Node* further = nearest(visit_branch, query, depth + 1, best_local, best_dist_local);
+    Node* further = nearest<M>(visit_branch, query, depth + 1, best_local, best_dist_local);
     if (further != nullptr){
-        float dist_further = further->point->distance_squared(*query);
+        float dist_further = M::distance(further->point->coordinates, query->coordinates, dim);
         if (dist_further < best_dist_local){
             best_dist_local = dist_further;
             best_local = further;
         }
     }
     
-    if (d_axis_squared < best_dist_local) {
-        further = nearest(other_branch, query, depth + 1, best_local, best_dist_local);
+    if (d_axis_bound < best_dist_local) {
+        further = nearest<M>(other_branch, query, depth + 1, best_local, best_dist_local);
         if (further != nullptr){
-            float dist_further = further->point->distance_squared(*query);
+            float dist_further = M::distance(further->point->coordinates, query->coordinates, dim);
             if (dist_further < best_dist_local){
                 // best_dist_local = dist_further;
                 best_local = further;
@@ -130,19 +115,47 @@ Node* nearest(Node* root, Point* query, int depth, Node* best, float &best_dist)
 }
 
 
+template<typename M>
 Node* nearest_neighbor(Node* root, Point* query){
-    float best_dist = root->point->distance_squared(*query);
-    return nearest(root, query, 0, root, best_dist);
+    float best_dist = M::distance(root->point->coordinates, query->coordinates, query->dimension);
+    return nearest<M>(root, query, 0, root, best_dist);
 }
 
 
 /***************************************************************************************/
+template<typename M>
+void solve_queries(Node* tree, float* x, int dim, int num_points, int num_queries){
+    // for each query, find nearest neighbor
+    for(int q = 0; q < num_queries; ++q){
+        float* x_query = x + (num_points + q) * dim;
+        Point query(dim, num_points + q, x_query);
+
+        Node* res = nearest_neighbor<M>(tree, &query);
+        
+        // output min-distance (i.e. to query point)
+        float min_distance = Metric::result<M>(
+            query.coordinates, res->point->coordinates, dim);
+        Utility::print_result_line(query.ID, min_distance);
+
+        #if DEBUG
+            // in case you want to have further debug information about
+            // the query point and the nearest neighbor
+            // std::cout << "Query: " << query << std::endl;
+            // std::cout << "NN: " << *res->point << std::endl << std::endl;
+        #endif
+    }
+}
+
+
 int main(int argc, char **argv){
     int seed = 0;
     int dim = 0;
     int num_points = 0;
     int num_queries = 10;
 
+    Utility::Options options;
+    argc = Utility::parse_options(argc, argv, &options, false);
+
     #if DEBUG
         // for measuring your local runtime
         auto tick = std::chrono::high_resolution_clock::now();
@@ -157,6 +170,21 @@ int main(int argc, char **argv){
     float* x = Utility::generate_problem(seed, dim, num_points + num_queries);
     Point** points = (Point**)calloc(num_points, sizeof(Point*));
 
+    // cosine distance is computed on unit vectors (points and queries)
+    if (options.metric == Metric::Type::Cosine){
+        for(int n = 0; n < num_points + num_queries; ++n){
+            Metric::normalize(x + n * dim, dim);
+        }
+    }
+
+    // inner product search runs on points and queries with one extra coordinate
+    if (options.metric == Metric::Type::InnerProduct){
+        float* augmented = Metric::augment(x, dim, num_points, num_queries);
+        free(x);
+        x = augmented;
+        dim += 1;
+    }
+
     for(int n = 0; n < num_points; ++n){
         points[n] = new Point(dim, n + 1, x + n * dim);
     }
@@ -164,23 +192,23 @@ int main(int argc, char **argv){
     // build tree
     Node* tree = build_tree(points, num_points);
     
-    // for each query, find nearest neighbor
-    for(int q = 0; q < num_queries; ++q){
-        float* x_query = x + (num_points + q) * dim;
-        Point query(dim, num_points + q, x_query);
-
-        Node* res = nearest_neighbor(tree, &query);
-        
-        // output min-distance (i.e. to query point)
-        float min_distance = query.distance(*res->point);
-        Utility::print_result_line(query.ID, min_distance);
-
-        #if DEBUG
-            // in case you want to have further debug information about
-            // the query point and the nearest neighbor
-            // std::cout << "Query: " << query << std::endl;
-            // std::cout << "NN: " << *res->point << std::endl << std::endl;
-        #endif
+    // dispatch on the metric once, each metric runs its own search loop
+    switch(options.metric){
+        case Metric::Type::Euclidean:
+            solve_queries<Metric::Euclidean>(tree, x, dim, num_points, num_queries);
+            break;
+        case Metric::Type::Manhattan:
+            solve_queries<Metric::Manhattan>(tree, x, dim, num_points, num_queries);
+            break;
+        case Metric::Type::Chebyshev:
+            solve_queries<Metric::Chebyshev>(tree, x, dim, num_points, num_queries);
+            break;
+        case Metric::Type::Cosine:
+            solve_queries<Metric::Cosine>(tree, x, dim, num_points, num_queries);
+            break;
+        case Metric::Type::InnerProduct:
+            solve_queries<Metric::InnerProduct>(tree, x, dim, num_points, num_queries);
+            break;
     }
     
     #if DEBUG